@@ -0,0 +1,255 @@
+#ifndef __ASSETPACK_HPP__
+#define __ASSETPACK_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace eirikr {
+
+    /* asset pack file layout (native endianness)
+     * | header | index entries, sorted by path | path strings | blobs, each ALIGNMENT aligned |
+     * paths are stored the way loaders ask for them, '/' separated, without a leading "./".
+     */
+    struct AssetPackHeader {
+        char magic[4]; // "EPAK"
+        std::uint32_t version;
+        std::uint32_t entryCount;
+        std::uint32_t reserved;
+    };
+
+    struct AssetPackEntry {
+        std::uint64_t offset;
+        std::uint64_t size;
+        std::uint32_t pathOffset; // from the start of the file
+        std::uint32_t pathLength;
+    };
+
+    /* read-only view of an asset pack
+     * the file is mmapped once, find() hands out pointers straight into the mapping,
+     * so decoders like stbi_load_from_memory read the pack pages without another copy.
+     * prefetch() asks the kernel to start reading a batch of blobs in one go,
+     * which is what makes a cold load off slow storage cheap. blobs are ALIGNMENT
+     * aligned in the file, but that isn't necessarily the page size (16K on arm64 macOS),
+     * so prefetch() rounds to the runtime page size itself.
+     */
+    class AssetPack {
+    public:
+        static const std::uint32_t VERSION = 1;
+        static const std::size_t ALIGNMENT = 4096;
+
+        struct Blob {
+            unsigned char const * data;
+            std::size_t size;
+        };
+
+    private:
+        unsigned char const * base;
+        std::size_t length;
+        AssetPackEntry const * entries;
+        std::uint32_t entryCount;
+        std::vector<unsigned char> buffer; // only used where there's no mmap
+
+    private:
+        AssetPackEntry const * lookup(std::string const & path) const;
+
+    public:
+        AssetPack(const char * path);
+        ~AssetPack();
+        AssetPack(AssetPack const &) = delete;
+        AssetPack & operator=(AssetPack const &) = delete;
+
+        static std::string normalize(std::string const & path);
+
+        bool contains(std::string const & path) const { return lookup(path) != nullptr; }
+        Blob find(std::string const & path) const;
+        std::size_t prefetch(std::vector<std::string> const & paths) const;
+        std::uint32_t size() const { return entryCount; }
+    };
+
+    /* builds a pack: add() every file under the path loaders will ask for, then write() */
+    class AssetPackWriter {
+    private:
+        struct Pending {
+            std::string path;
+            std::vector<unsigned char> bytes;
+        };
+        std::vector<Pending> pending;
+
+    public:
+        void add(std::string const & packPath, std::vector<unsigned char> bytes);
+        void addFile(std::string const & packPath, const char * filePath);
+        void write(const char * outPath) const;
+    };
+
+    AssetPack::AssetPack(const char * path) {
+        base = nullptr;
+        length = 0;
+#ifndef _WIN32
+        auto fd = open(path, O_RDONLY);
+        if (fd < 0) throw std::logic_error(std::string("Error: asset pack failed to open at path ") + path + "\n");
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            length = static_cast<std::size_t>(info.st_size);
+            auto mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) base = static_cast<unsigned char const *>(mapped);
+        }
+        close(fd); // the mapping keeps the file alive
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file) throw std::logic_error(std::string("Error: asset pack failed to open at path ") + path + "\n");
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        length = buffer.size();
+        if (length) base = &buffer[0];
+#endif
+        auto header = reinterpret_cast<AssetPackHeader const *>(base);
+        bool valid = base && length >= sizeof(AssetPackHeader) && std::memcmp(header->magic, "EPAK", 4) == 0 &&
+                     header->version == VERSION &&
+                     header->entryCount <= (length - sizeof(AssetPackHeader)) / sizeof(AssetPackEntry);
+        if (valid) {
+            entryCount = header->entryCount;
+            entries = reinterpret_cast<AssetPackEntry const *>(base + sizeof(AssetPackHeader));
+            for (std::uint32_t i = 0; i < entryCount && valid; ++i) {
+                auto & entry = entries[i];
+                valid = entry.offset <= length && entry.size <= length - entry.offset &&
+                        entry.pathOffset <= length && entry.pathLength <= length - entry.pathOffset;
+            }
+        }
+        if (!valid) {
+#ifndef _WIN32
+            if (base) munmap(const_cast<unsigned char *>(base), length);
+#endif
+            throw std::logic_error(std::string("Error: not a valid asset pack at path ") + path + "\n");
+        }
+    }
+
+    AssetPack::~AssetPack() {
+#ifndef _WIN32
+        munmap(const_cast<unsigned char *>(base), length);
+#endif
+    }
+
+    // "./a//b\\c.png" -> "a/b/c.png"
+    std::string AssetPack::normalize(std::string const & path) {
+        std::string result;
+        for (auto c : path) {
+            if (c == '\\') c = '/';
+            if (c == '/' && (result.empty() || result.back() == '/')) continue;
+            result.push_back(c);
+        }
+        while (result.compare(0, 2, "./") == 0) result.erase(0, 2);
+        return result;
+    }
+
+    AssetPackEntry const * AssetPack::lookup(std::string const & path) const {
+        auto key = normalize(path);
+        auto less = [this](AssetPackEntry const & entry, std::string const & k) {
+            auto name = reinterpret_cast<char const *>(base + entry.pathOffset);
+            auto n = std::min<std::size_t>(entry.pathLength, k.size());
+            auto cmp = std::memcmp(name, k.data(), n);
+            return cmp < 0 || (cmp == 0 && entry.pathLength < k.size());
+        };
+        auto found = std::lower_bound(entries, entries + entryCount, key, less);
+        if (found == entries + entryCount || found->pathLength != key.size() ||
+            std::memcmp(base + found->pathOffset, key.data(), key.size()) != 0) {
+            return nullptr;
+        }
+        return found;
+    }
+
+    AssetPack::Blob AssetPack::find(std::string const & path) const {
+        auto entry = lookup(path);
+        if (!entry) return { nullptr, 0 };
+        return { base + entry->offset, static_cast<std::size_t>(entry->size) };
+    }
+
+    // returns how many of `paths` had their reads queued
+    std::size_t AssetPack::prefetch(std::vector<std::string> const & paths) const {
+        std::size_t queued = 0;
+#ifndef _WIN32
+        static const auto pageSize = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+        for (auto const & path : paths) {
+            auto entry = lookup(path);
+            if (!entry || !entry->size) continue;
+            // madvise wants a page aligned start, so widen the range down to the page holding the blob
+            auto start = reinterpret_cast<std::uintptr_t>(base + entry->offset);
+            auto aligned = start & ~(pageSize - 1);
+            auto size = static_cast<std::size_t>(entry->size) + static_cast<std::size_t>(start - aligned);
+            if (madvise(reinterpret_cast<void *>(aligned), size, MADV_WILLNEED) == 0) ++queued;
+        }
+#endif
+        return queued;
+    }
+
+    void AssetPackWriter::add(std::string const & packPath, std::vector<unsigned char> bytes) {
+        auto path = AssetPack::normalize(packPath);
+        for (auto & existing : pending) {
+            if (existing.path == path) {
+                existing.bytes = std::move(bytes);
+                return;
+            }
+        }
+        pending.push_back({ path, std::move(bytes) });
+    }
+
+    void AssetPackWriter::addFile(std::string const & packPath, const char * filePath) {
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file) throw std::logic_error(std::string("Error: asset failed to load at path ") + filePath + "\n");
+        add(packPath, std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+    }
+
+    void AssetPackWriter::write(const char * outPath) const {
+        std::vector<Pending const *> sorted;
+        for (auto & p : pending) sorted.push_back(&p);
+        std::sort(sorted.begin(), sorted.end(), [](Pending const * a, Pending const * b) { return a->path < b->path; });
+
+        // lay out the index and strings first, the blobs follow on aligned offsets
+        auto align = [](std::uint64_t v) { return (v + AssetPack::ALIGNMENT - 1) / AssetPack::ALIGNMENT * AssetPack::ALIGNMENT; };
+        std::vector<AssetPackEntry> entries(sorted.size());
+        std::uint64_t offset = sizeof(AssetPackHeader) + sizeof(AssetPackEntry) * sorted.size();
+        for (std::size_t i = 0; i < sorted.size(); ++i) {
+            entries[i].pathOffset = static_cast<std::uint32_t>(offset);
+            entries[i].pathLength = static_cast<std::uint32_t>(sorted[i]->path.size());
+            offset += sorted[i]->path.size();
+        }
+        for (std::size_t i = 0; i < sorted.size(); ++i) {
+            offset = align(offset);
+            entries[i].offset = offset;
+            entries[i].size = sorted[i]->bytes.size();
+            offset += sorted[i]->bytes.size();
+        }
+
+        std::ofstream file(outPath, std::ios::binary | std::ios::trunc);
+        if (!file) throw std::logic_error(std::string("Error: asset pack failed to write at path ") + outPath + "\n");
+        AssetPackHeader header;
+        std::memcpy(header.magic, "EPAK", 4);
+        header.version = AssetPack::VERSION;
+        header.entryCount = static_cast<std::uint32_t>(entries.size());
+        header.reserved = 0;
+        file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        if (!entries.empty()) file.write(reinterpret_cast<char const *>(&entries[0]), sizeof(AssetPackEntry) * entries.size());
+        for (auto p : sorted) file.write(p->path.data(), p->path.size());
+        for (std::size_t i = 0; i < sorted.size(); ++i) {
+            std::uint64_t position = file.tellp();
+            std::vector<char> padding(static_cast<std::size_t>(entries[i].offset - position), 0);
+            if (!padding.empty()) file.write(&padding[0], padding.size());
+            if (!sorted[i]->bytes.empty()) file.write(reinterpret_cast<char const *>(&sorted[i]->bytes[0]), sorted[i]->bytes.size());
+        }
+        if (!file) throw std::logic_error(std::string("Error: asset pack failed to write at path ") + outPath + "\n");
+    }
+
+}
+
+#endif /* __ASSETPACK_HPP__ */
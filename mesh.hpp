@@ -8,6 +8,9 @@
 
 #ifndef mesh_h
 #define mesh_h
+#include <cstring>
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <headers.hpp>
@@ -21,6 +24,20 @@ namespace eirikr {
         glm::vec2 texCoords;
     };
     
+    /* a texture that was packed into a texture array page at import time
+     * `unit` is the texture unit its page is bound to: the model's shared pages take units 0..n-1
+     * by page index, textures that didn't fit into them get a single-layer page of their own on a
+     * unit past those. the mesh binds its pages along with the rest of its material, so meshes of
+     * different packed models can be drawn in any order.
+     */
+    struct PackedTexture {
+        std::string type;
+        unsigned int page; // GL name of the GL_TEXTURE_2D_ARRAY holding it
+        unsigned int unit;
+        unsigned int layer;
+        glm::vec4 rect; // xy: uv offset, zw: uv scale
+    };
+    
     /*
     struct Texture {
         unsigned int id;
@@ -33,10 +50,20 @@ namespace eirikr {
         std::vector<Vertex> vertices;
         std::vector<unsigned int> indices;
         std::vector<Texture> textures;
+        std::vector<PackedTexture> packedTextures; // replaces `textures` when the model was packed
+        glm::vec3 boundsMin; // object-space bounding box, used for occlusion tests
+        glm::vec3 boundsMax;
+        bool occluder; // rasterized into the occlusion buffer instead of being tested against it
+        unsigned int materialID; // meshes sharing the exact same texture list share this id
         
     public:
         Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
         void draw(eirikr::Shader shader);
+        void bindTextures(unsigned int program) const;
+        unsigned int getVAO() const { return VAO; }
+        
+        static unsigned int registerMaterial(std::vector<Texture> const & textures);
+        static unsigned int registerMaterial(std::vector<PackedTexture> const & textures);
         
     private:
         unsigned int VAO;
@@ -45,14 +72,64 @@ namespace eirikr {
         
     private:
         void setupMesh();
+        void computeBounds();
+        static unsigned int lookupMaterial(std::vector<unsigned int> const & key);
     };
     
     Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures) {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->occluder = false;
+        this->materialID = registerMaterial(textures);
+        computeBounds();
         setupMesh();
     }
+    
+    // hands out a small id per distinct (ordered) list of texture ids, 0 is "no textures"
+    unsigned int Mesh::lookupMaterial(std::vector<unsigned int> const & key) {
+        static std::mutex lock;
+        static std::map<std::vector<unsigned int>, unsigned int> materials;
+        std::lock_guard<std::mutex> guard(lock);
+        auto found = materials.find(key);
+        if (found != materials.end()) return found->second;
+        auto id = static_cast<unsigned int>(materials.size()) + 1;
+        materials[key] = id;
+        return id;
+    }
+    
+    unsigned int Mesh::registerMaterial(std::vector<Texture> const & textures) {
+        if (textures.empty()) return 0;
+        std::vector<unsigned int> key;
+        for (auto const & texture : textures) {
+            key.push_back(texture.ID);
+        }
+        return lookupMaterial(key);
+    }
+    
+    // packed textures are told apart by page, layer and uv offset, the leading ~0u keeps them
+    // from colliding with plain texture id lists
+    unsigned int Mesh::registerMaterial(std::vector<PackedTexture> const & textures) {
+        if (textures.empty()) return 0;
+        std::vector<unsigned int> key(1, ~0u);
+        for (auto const & texture : textures) {
+            unsigned int offset[2];
+            std::memcpy(offset, &texture.rect.x, sizeof(offset));
+            key.insert(key.end(), { texture.page, texture.layer, offset[0], offset[1] });
+        }
+        return lookupMaterial(key);
+    }
+    
+    void Mesh::computeBounds() {
+        boundsMin = glm::vec3(0.0f, 0.0f, 0.0f);
+        boundsMax = glm::vec3(0.0f, 0.0f, 0.0f);
+        if (vertices.empty()) return;
+        boundsMin = boundsMax = vertices[0].position;
+        for (auto const & vertex : vertices) {
+            boundsMin = glm::min(boundsMin, vertex.position);
+            boundsMax = glm::max(boundsMax, vertex.position);
+        }
+    }
 
     void Mesh::setupMesh() {
         glGenVertexArrays(1, &VAO);
@@ -85,13 +162,35 @@ namespace eirikr {
      * uniform sampler2D texture_diffuse2;
      * uniform sampler2D texture_specular1;
      * uniform sampler2D texture_specular2;
+     *
+     * packed meshes use arrays instead, with the layer and uv rect alongside
+     * uniform sampler2DArray texture_diffuse1;
+     * uniform float texture_diffuse1_layer;
+     * uniform vec4 texture_diffuse1_rect;
      */
      
-    void Mesh::draw(Shader shader) {
+    void Mesh::bindTextures(unsigned int program) const {
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr = 1;
         unsigned int heightNr = 1;
+        // other packed models put their pages on the same units, so always bind ours
+        for (unsigned int i = 0; i < packedTextures.size(); ++i) {
+            auto & packed = packedTextures[i];
+            glActiveTexture(GL_TEXTURE0 + packed.unit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, packed.page);
+            auto name = packed.type;
+            auto number = std::string();
+            if (name == "texture_diffuse") { number = std::to_string(diffuseNr++); }
+            else if (name == "texture_specular") { number = std::to_string(specularNr++); }
+            else if (name == "texture_normal") { number = std::to_string(normalNr++); }
+            else if (name == "texture_height") { number = std::to_string(heightNr++); }
+            glUniform1i(glGetUniformLocation(program, (name + number).c_str()), packed.unit);
+            glUniform1f(glGetUniformLocation(program, (name + number + "_layer").c_str()), static_cast<float>(packed.layer));
+            glUniform4f(glGetUniformLocation(program, (name + number + "_rect").c_str()),
+                        packed.rect.x, packed.rect.y, packed.rect.z, packed.rect.w);
+        }
+        if (!packedTextures.empty()) glActiveTexture(GL_TEXTURE0);
         for (unsigned int i = 0; i < textures.size(); ++i) {
             glActiveTexture(GL_TEXTURE0 + i);
             auto name = textures[i].type;
@@ -100,9 +199,13 @@ namespace eirikr {
             else if (name == "texture_specular") { number = std::to_string(specularNr++); }
             else if (name == "texture_normal") { number = std::to_string(normalNr++); }
             else if (name == "texture_height") { number = std::to_string(heightNr++); }
-            shader.setInt((name + number).c_str(), i);
+            glUniform1i(glGetUniformLocation(program, (name + number).c_str()), i);
             glBindTexture(GL_TEXTURE_2D, textures[i].ID);
         }
+    }
+     
+    void Mesh::draw(Shader shader) {
+        bindTextures(shader.ID);
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0); // unbind
@@ -8,28 +8,95 @@
 
 #ifndef model_h
 #define model_h
+#include <set>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
 #include "mesh.hpp"
 #include "texture.hpp"
+#include "texturearray.hpp"
+#include "occlusion.hpp"
+#include "renderqueue.hpp"
 
 namespace eirikr {
+    /* lets Assimp open the model and everything it references (.mtl, .bin, ...) out of an asset pack */
+    class AssetPackIOStream : public Assimp::IOStream {
+    private:
+        AssetPack::Blob blob;
+        std::size_t position;
+        
+    public:
+        AssetPackIOStream(AssetPack::Blob blob) : blob(blob), position(0) {}
+        size_t Read(void * buffer, size_t size, size_t count) override {
+            if (!size) return 0;
+            auto items = std::min(count, (blob.size - position) / size);
+            std::memcpy(buffer, blob.data + position, items * size);
+            position += items * size;
+            return items;
+        }
+        size_t Write(const void *, size_t, size_t) override { return 0; }
+        aiReturn Seek(size_t offset, aiOrigin origin) override {
+            std::size_t target = offset;
+            if (origin == aiOrigin_CUR) target = position + offset;
+            else if (origin == aiOrigin_END) target = blob.size - offset;
+            if (target > blob.size) return aiReturn_FAILURE;
+            position = target;
+            return aiReturn_SUCCESS;
+        }
+        size_t Tell() const override { return position; }
+        size_t FileSize() const override { return blob.size; }
+        void Flush() override {}
+    };
+    
+    class AssetPackIOSystem : public Assimp::IOSystem {
+    private:
+        AssetPack const & pack;
+        
+    public:
+        AssetPackIOSystem(AssetPack const & pack) : pack(pack) {}
+        bool Exists(const char * path) const override { return pack.contains(path); }
+        char getOsSeparator() const override { return '/'; }
+        Assimp::IOStream * Open(const char * path, const char * mode = "rb") override {
+            auto blob = pack.find(path);
+            if (!blob.data || std::strchr(mode, 'w')) return nullptr;
+            return new AssetPackIOStream(blob);
+        }
+        void Close(Assimp::IOStream * stream) override { delete stream; }
+    };
+    
     class Model {
     public:
-        Model(char const * path) { loadModel(path); }
+        // packTextures: pack material textures into texture arrays / atlases at import time
+        Model(char const * path, bool packTextures = false) : packTextures(packTextures), pack(nullptr) { loadModel(path); }
+        // resolves the model, its textures and everything else it references through `pack`, which must outlive loading
+        Model(char const * path, AssetPack const & pack, bool packTextures = false) : packTextures(packTextures), pack(&pack) {
+            loadModel(path);
+        }
         void draw(Shader & shader);
+        void addOccluders(OcclusionCuller & culler, glm::mat4 const & model = glm::mat4(1.0f)) const;
+        void draw(Shader & shader, OcclusionCuller const & culler, glm::mat4 const & model = glm::mat4(1.0f));
+        void record(RenderQueue::Recorder & recorder, Shader & shader, Camera & camera, glm::mat4 const * model = nullptr,
+                    unsigned int first = 0, unsigned int count = ~0u) const;
+        void setOccluder(unsigned int meshIndex, bool isOccluder);
+        unsigned int getMeshCount() const { return static_cast<unsigned int>(meshes.size()); }
         
     private:
         std::vector<Mesh> meshes;
         std::vector<Texture> textures_loaded;
         std::string directory;
+        bool packTextures;
+        AssetPack const * pack;
+        std::vector<unsigned int> texturePages; // GL_TEXTURE_2D_ARRAYs, bound to units 0..n-1
         
     private:
         void loadModel(std::string const & path);
         void processNode(aiNode * node, const aiScene * scene);
         Mesh processMesh(aiMesh * mesh, const aiScene * scene);
         std::vector<Texture> loadMaterialTextures(aiMaterial * mat, aiTextureType type, std::string typeName);
+        void packMaterialTextures();
+        void prefetchMaterialTextures(const aiScene * scene);
     };
     
     void Model::draw(Shader & shader) {
@@ -38,8 +105,61 @@ namespace eirikr {
         }
     }
     
+    /* occlusion culling, once per frame across every model:
+     *     culler.clear();
+     *     culler.setViewProjection(camera);
+     *     for each model: model.addOccluders(culler, modelMatrix);
+     *     culler.rasterize();
+     *     for each model: model.draw(shader, culler, modelMatrix);
+     * so occluders of one model can hide meshes of any other.
+     * `model` has to be the same model matrix the shader uses.
+     */
+    void Model::addOccluders(OcclusionCuller & culler, glm::mat4 const & model) const {
+        for (unsigned int i = 0; i < meshes.size(); ++i) {
+            auto & mesh = meshes[i];
+            if (mesh.occluder && !mesh.vertices.empty() && !mesh.indices.empty()) {
+                culler.addOccluder(&mesh.vertices[0].position, sizeof(Vertex), mesh.vertices.size(),
+                                   &mesh.indices[0], mesh.indices.size(), model);
+            }
+        }
+    }
+    
+    // occluders are drawn unconditionally, every other mesh only if its bounding box survives the hierarchical z test
+    void Model::draw(Shader & shader, OcclusionCuller const & culler, glm::mat4 const & model) {
+        for (unsigned int i = 0; i < meshes.size(); ++i) {
+            auto & mesh = meshes[i];
+            if (mesh.occluder || culler.isVisible(mesh.boundsMin, mesh.boundsMax, model)) {
+                mesh.draw(shader);
+            }
+        }
+    }
+    
+    /* records meshes [first, first + count) into a render queue instead of drawing them
+     * safe to call from several threads at once as long as each one has its own recorder.
+     * `model`, if given, is uploaded as the "model" uniform at replay and must stay alive until then.
+     */
+    void Model::record(RenderQueue::Recorder & recorder, Shader & shader, Camera & camera, glm::mat4 const * model,
+                       unsigned int first, unsigned int count) const {
+        if (first >= meshes.size()) return;
+        auto last = (count < meshes.size() - first) ? first + count : meshes.size();
+        auto eye = camera.getCameraPos();
+        for (auto i = static_cast<std::size_t>(first); i < last; ++i) {
+            auto & mesh = meshes[i];
+            auto center = glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f);
+            if (model) center = *model * center;
+            // map [0, inf) distances into [0, 1) while keeping them ordered
+            auto distance = glm::length(glm::vec3(center) - eye);
+            recorder.submit(mesh, shader.ID, distance / (distance + 1.0f), model);
+        }
+    }
+    
+    void Model::setOccluder(unsigned int meshIndex, bool isOccluder) {
+        meshes.at(meshIndex).occluder = isOccluder;
+    }
+    
     void Model::loadModel(std::string const & path) {
         Assimp::Importer importer;
+        if (pack) importer.SetIOHandler(new AssetPackIOSystem(*pack)); // the importer owns and deletes it
         // aiProcess_Triangulate: triangulate the model if it's not all triangle
         // aiProcess_FlipUVs: get UV coordinates with the upper-left corner as origin
         // aiProcess_GenNormals: generate normal for every vertex
@@ -53,7 +173,9 @@ namespace eirikr {
         }
         
         directory = path.substr(0, path.find_last_of('/'));
+        if (pack) prefetchMaterialTextures(scene);
         processNode(scene->mRootNode, scene);
+        if (packTextures) packMaterialTextures();
     }
     
     void Model::processNode(aiNode * node, const aiScene * scene) {
@@ -161,7 +283,8 @@ namespace eirikr {
             if (!skip) {
                 Texture texture;
                 auto fullpath = directory + "/" + str.C_Str();
-                texture.ID = texture.loadTextureFromPath(fullpath.c_str());
+                // packed textures are only read once every mesh is known, see packMaterialTextures
+                texture.ID = packTextures ? 0 : texture.loadTextureFromPath(fullpath.c_str(), pack);
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -170,6 +293,97 @@ namespace eirikr {
         }
         return textures;
     }
+    
+    // kicks off reads for every texture of every material at once instead of one file at a time
+    void Model::prefetchMaterialTextures(const aiScene * scene) {
+        std::vector<std::string> paths;
+        aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+        for (unsigned i = 0; i < scene->mNumMaterials; ++i) {
+            for (auto type : types) {
+                for (unsigned j = 0; j < scene->mMaterials[i]->GetTextureCount(type); ++j) {
+                    aiString str;
+                    scene->mMaterials[i]->GetTexture(type, j, &str);
+                    paths.push_back(directory + "/" + str.C_Str());
+                }
+            }
+        }
+        pack->prefetch(paths);
+    }
+    
+    void Model::packMaterialTextures() {
+        // every shared page takes the unit of its index, keep enough free past them for
+        // the single-layer pages a mesh gets when the model doesn't fit
+        GLint units = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+        if (units <= 0) units = 16; // the GL 3.3 minimum
+        std::size_t perMesh = 0;
+        for (auto const & mesh : meshes) {
+            perMesh = std::max(perMesh, mesh.textures.size());
+        }
+        auto maxPages = static_cast<std::size_t>(units) > perMesh ? units - perMesh : 1;
+        TexturePacker packer(2048, 8, 256, static_cast<unsigned int>(maxPages));
+        std::vector<unsigned char *> images;
+        std::map<std::string, unsigned int> handles;
+        
+        // textures sampled with tiling uvs need GL_REPEAT, which atlases can't give them
+        std::set<std::string> repeating;
+        for (auto const & mesh : meshes) {
+            bool tiles = false;
+            for (auto const & vertex : mesh.vertices) {
+                auto uv = vertex.texCoords;
+                if (uv.x < -1e-3f || uv.x > 1.001f || uv.y < -1e-3f || uv.y > 1.001f) { tiles = true; break; }
+            }
+            if (!tiles) continue;
+            for (auto const & texture : mesh.textures) {
+                repeating.insert(texture.path);
+            }
+        }
+        
+        for (auto & texture : textures_loaded) {
+            auto fullpath = directory + "/" + texture.path;
+            auto blob = pack ? pack->find(fullpath) : AssetPack::Blob{ nullptr, 0 };
+            auto data = blob.data
+                ? stbi_load_from_memory(blob.data, static_cast<int>(blob.size), &texture.texWidth, &texture.texHeight, &texture.texComponents, 0)
+                : stbi_load(fullpath.c_str(), &texture.texWidth, &texture.texHeight, &texture.texComponents, 0);
+            if (!data) {
+                for (auto image : images) stbi_image_free(image);
+                throw std::logic_error(std::string("Error: texture failed to load at path ") + fullpath + "\n");
+            }
+            images.push_back(data);
+            handles[texture.path] = packer.add(texture.texWidth, texture.texHeight, texture.texComponents, data,
+                                               repeating.count(texture.path) != 0);
+        }
+        packer.pack();
+        texturePages = packer.upload();
+        
+        // whatever didn't make it into the pages gets a repeating single-layer page of its own
+        std::map<std::string, unsigned int> overflow;
+        for (auto const & texture : textures_loaded) {
+            auto & placement = packer.getPlacement(handles[texture.path]);
+            if (placement.page != TexturePacker::UNPACKED) continue;
+            TexturePacker single(2048, 8, 1, 1);
+            single.add(texture.texWidth, texture.texHeight, texture.texComponents, images[handles[texture.path]], true);
+            single.pack();
+            overflow[texture.path] = single.upload()[0];
+        }
+        for (auto image : images) stbi_image_free(image);
+        
+        for (auto & mesh : meshes) {
+            auto unit = static_cast<unsigned int>(texturePages.size());
+            for (auto const & texture : mesh.textures) {
+                auto & placement = packer.getPlacement(handles[texture.path]);
+                if (placement.page == TexturePacker::UNPACKED) {
+                    mesh.packedTextures.push_back({ texture.type, overflow[texture.path], unit++, 0,
+                                                    glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) });
+                    continue;
+                }
+                mesh.packedTextures.push_back({ texture.type, texturePages[placement.page], placement.page,
+                                                placement.layer, placement.rect });
+            }
+            mesh.textures.clear();
+            mesh.materialID = Mesh::registerMaterial(mesh.packedTextures);
+        }
+    }
 }
 
 #endif /* model_h */
@@ -0,0 +1,451 @@
+#ifndef __OCCLUSION_HPP__
+#define __OCCLUSION_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "camera.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EIRIKR_OCCLUSION_SSE2
+#define EIRIKR_OCCLUSION_SIMD
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define EIRIKR_OCCLUSION_NEON
+#define EIRIKR_OCCLUSION_SIMD
+#include <arm_neon.h>
+#endif
+
+namespace eirikr {
+
+#ifdef EIRIKR_OCCLUSION_SIMD
+    /* the 4-wide operations the rasterizer needs, on SSE2 or NEON
+     * comparisons return all-ones / all-zero lanes, kept as Float4 so masks combine like values.
+     */
+    namespace lanes {
+#ifdef EIRIKR_OCCLUSION_SSE2
+        typedef __m128 Float4;
+        inline Float4 splat(float v) { return _mm_set1_ps(v); }
+        inline Float4 set(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+        inline Float4 load(float const * p) { return _mm_loadu_ps(p); }
+        inline void store(float * p, Float4 v) { _mm_storeu_ps(p, v); }
+        inline Float4 add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+        inline Float4 mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+        inline Float4 greaterEqual(Float4 a, Float4 b) { return _mm_cmpge_ps(a, b); }
+        inline Float4 less(Float4 a, Float4 b) { return _mm_cmplt_ps(a, b); }
+        inline Float4 both(Float4 a, Float4 b) { return _mm_and_ps(a, b); }
+        inline Float4 select(Float4 mask, Float4 a, Float4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+        inline bool any(Float4 mask) { return _mm_movemask_ps(mask) != 0; }
+#else
+        typedef float32x4_t Float4;
+        inline Float4 splat(float v) { return vdupq_n_f32(v); }
+        inline Float4 set(float a, float b, float c, float d) { float const v[4] = { a, b, c, d }; return vld1q_f32(v); }
+        inline Float4 load(float const * p) { return vld1q_f32(p); }
+        inline void store(float * p, Float4 v) { vst1q_f32(p, v); }
+        inline Float4 add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+        inline Float4 mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+        inline Float4 greaterEqual(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+        inline Float4 less(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+        inline Float4 both(Float4 a, Float4 b) {
+            return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+        }
+        inline Float4 select(Float4 mask, Float4 a, Float4 b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+        inline bool any(Float4 mask) {
+            auto bits = vreinterpretq_u32_f32(mask);
+            auto half = vorr_u32(vget_low_u32(bits), vget_high_u32(bits));
+            return vget_lane_u32(vpmax_u32(half, half), 0) != 0;
+        }
+#endif
+    }
+#endif
+
+    /* software occlusion culling
+     * occluder triangles are rasterized on the CPU into a small depth buffer,
+     * the buffer is reduced into a max-depth pyramid (hierarchical z)
+     * and bounding boxes are tested against the pyramid before they're drawn.
+     * depth is stored as window-space z in [0, 1], 1 being the far plane.
+     * occluders only write pixels they cover completely, so edges shared between
+     * two triangles stay open by up to a pixel; that loses some occlusion, but a box
+     * is never reported hidden unless every pixel it touches is.
+     * nothing in here touches OpenGL, so it can run without a context.
+     */
+    class OcclusionCuller {
+    public:
+        static const int TILE_SIZE = 32; // must be a multiple of 4
+
+    private:
+        struct ScreenTriangle {
+            float x[3];
+            float y[3];
+            float z[3];
+        };
+
+        int width;
+        int height;
+        int tilesX;
+        int tilesY;
+        int stride; // row pitch of the depth buffer, padded to whole tiles
+        unsigned int threadCount;
+
+        glm::mat4 viewProjection;
+        std::vector<float> depthBuffer;
+        std::vector<std::vector<float>> hiZ; // hiZ[0] is width * height, each level halves
+        std::vector<int> hiZWidth;
+        std::vector<int> hiZHeight;
+        std::vector<ScreenTriangle> triangles;
+        std::vector<std::vector<unsigned int>> bins; // triangle indices per tile
+
+        // worker pool, started once and woken for every rasterize()
+        std::vector<std::thread> workers;
+        std::mutex poolLock;
+        std::condition_variable wake;
+        std::condition_variable done;
+        unsigned int generation;
+        unsigned int busy;
+        bool stopping;
+        std::atomic<int> nextTile;
+
+    private:
+        static int toPixel(float v, int lo, int hi);
+        void rasterizeTile(int tile);
+        void rasterizeTiles();
+        void workerLoop();
+        void buildHiZ();
+
+    public:
+        OcclusionCuller(int width = 256, int height = 128, unsigned int threads = 0);
+        ~OcclusionCuller();
+        OcclusionCuller(OcclusionCuller const &) = delete;
+        OcclusionCuller & operator=(OcclusionCuller const &) = delete;
+
+        void clear();
+        void setViewProjection(glm::mat4 const & vp);
+        void setViewProjection(Camera & camera);
+        void addOccluder(void const * positions, std::size_t vertexStride, std::size_t vertexCount,
+                         unsigned int const * indices, std::size_t indexCount, glm::mat4 const & model);
+        void addOccluder(std::vector<glm::vec3> const & positions, std::vector<unsigned int> const & indices,
+                         glm::mat4 const & model);
+        void rasterize();
+        bool isVisible(glm::vec3 const & boundsMin, glm::vec3 const & boundsMax, glm::mat4 const & model) const;
+
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        float getDepth(int x, int y) const { return depthBuffer[y * stride + x]; }
+        std::size_t getOccluderTriangleCount() const { return triangles.size(); }
+    };
+
+    OcclusionCuller::OcclusionCuller(int width, int height, unsigned int threads) {
+        this->width = width;
+        this->height = height;
+        tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        stride = tilesX * TILE_SIZE;
+        threadCount = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+        viewProjection = glm::mat4(1.0f);
+        depthBuffer.assign(stride * tilesY * TILE_SIZE, 1.0f);
+        bins.resize(tilesX * tilesY);
+
+        // every level halves (rounding up) until we're down to a single texel
+        int w = width, h = height;
+        while (true) {
+            hiZ.push_back(std::vector<float>(w * h, 1.0f));
+            hiZWidth.push_back(w);
+            hiZHeight.push_back(h);
+            if (w == 1 && h == 1) break;
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+
+        // the calling thread works too, so it only needs threadCount - 1 helpers
+        generation = 0;
+        busy = 0;
+        stopping = false;
+        nextTile = 0;
+        auto helpers = std::min(threadCount, static_cast<unsigned int>(tilesX * tilesY)) - 1;
+        for (unsigned int i = 0; i < helpers; ++i) {
+            workers.emplace_back(&OcclusionCuller::workerLoop, this);
+        }
+    }
+
+    OcclusionCuller::~OcclusionCuller() {
+        {
+            std::lock_guard<std::mutex> guard(poolLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto & t : workers) {
+            t.join();
+        }
+    }
+
+    void OcclusionCuller::workerLoop() {
+        unsigned int seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(poolLock);
+                wake.wait(guard, [this, seen]() { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            rasterizeTiles();
+            {
+                std::lock_guard<std::mutex> guard(poolLock);
+                if (--busy == 0) done.notify_one();
+            }
+        }
+    }
+
+    // clamps in float before converting, screen coordinates can be far outside the int range
+    int OcclusionCuller::toPixel(float v, int lo, int hi) {
+        v = std::min(std::max(v, static_cast<float>(lo)), static_cast<float>(hi));
+        return static_cast<int>(std::floor(v));
+    }
+
+    void OcclusionCuller::clear() {
+        std::fill(depthBuffer.begin(), depthBuffer.end(), 1.0f);
+        for (auto & level : hiZ) {
+            std::fill(level.begin(), level.end(), 1.0f);
+        }
+        for (auto & bin : bins) {
+            bin.clear();
+        }
+        triangles.clear();
+    }
+
+    void OcclusionCuller::setViewProjection(glm::mat4 const & vp) {
+        viewProjection = vp;
+    }
+
+    void OcclusionCuller::setViewProjection(Camera & camera) {
+        viewProjection = camera.getCameraProjection() * camera.getCameraView();
+    }
+
+    void OcclusionCuller::addOccluder(void const * positions, std::size_t vertexStride, std::size_t vertexCount,
+                                      unsigned int const * indices, std::size_t indexCount, glm::mat4 const & model) {
+        auto mvp = viewProjection * model;
+        auto bytes = static_cast<unsigned char const *>(positions);
+
+        // project every vertex once, triangles just pick them up by index
+        std::vector<glm::vec4> clip(vertexCount);
+        for (std::size_t i = 0; i < vertexCount; ++i) {
+            auto p = reinterpret_cast<glm::vec3 const *>(bytes + i * vertexStride);
+            clip[i] = mvp * glm::vec4(*p, 1.0f);
+        }
+
+        for (std::size_t i = 0; i + 2 < indexCount; i += 3) {
+            ScreenTriangle tri;
+            bool behind = false;
+            for (int k = 0; k < 3; ++k) {
+                auto & c = clip[indices[i + k]];
+                // we don't clip against the near plane, dropping the triangle
+                // only loses occlusion and never hides something that's visible.
+                // it also keeps w >= near, so the divide below stays bounded
+                if (c.w <= 1e-5f || c.z < -c.w) { behind = true; break; }
+                tri.x[k] = (c.x / c.w * 0.5f + 0.5f) * width;
+                tri.y[k] = (c.y / c.w * 0.5f + 0.5f) * height;
+                tri.z[k] = c.z / c.w * 0.5f + 0.5f;
+            }
+            if (behind) continue;
+
+            // both windings are rasterized, so make them all counter-clockwise
+            auto area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+            if (area == 0.0f) continue;
+            if (area < 0.0f) {
+                std::swap(tri.x[1], tri.x[2]);
+                std::swap(tri.y[1], tri.y[2]);
+                std::swap(tri.z[1], tri.z[2]);
+            }
+
+            auto minX = toPixel(std::min({ tri.x[0], tri.x[1], tri.x[2] }), 0, width);
+            auto maxX = toPixel(std::max({ tri.x[0], tri.x[1], tri.x[2] }), -1, width - 1);
+            auto minY = toPixel(std::min({ tri.y[0], tri.y[1], tri.y[2] }), 0, height);
+            auto maxY = toPixel(std::max({ tri.y[0], tri.y[1], tri.y[2] }), -1, height - 1);
+            if (minX > maxX || minY > maxY) continue;
+
+            // bin the triangle into every tile its bounding rectangle touches
+            auto index = static_cast<unsigned int>(triangles.size());
+            triangles.push_back(tri);
+            for (int ty = minY / TILE_SIZE; ty <= maxY / TILE_SIZE; ++ty) {
+                for (int tx = minX / TILE_SIZE; tx <= maxX / TILE_SIZE; ++tx) {
+                    bins[ty * tilesX + tx].push_back(index);
+                }
+            }
+        }
+    }
+
+    void OcclusionCuller::addOccluder(std::vector<glm::vec3> const & positions, std::vector<unsigned int> const & indices,
+                                      glm::mat4 const & model) {
+        if (positions.empty() || indices.empty()) return;
+        addOccluder(&positions[0], sizeof(glm::vec3), positions.size(), &indices[0], indices.size(), model);
+    }
+
+    void OcclusionCuller::rasterizeTile(int tile) {
+        auto tileX = (tile % tilesX) * TILE_SIZE;
+        auto tileY = (tile / tilesX) * TILE_SIZE;
+
+        for (auto index : bins[tile]) {
+            auto & tri = triangles[index];
+
+            // edge functions e(x, y) = a * x + b * y + c, positive on the inside
+            float a[3], b[3], c[3];
+            for (int k = 0; k < 3; ++k) {
+                int n = (k + 1) % 3;
+                a[k] = tri.y[k] - tri.y[n];
+                b[k] = tri.x[n] - tri.x[k];
+                c[k] = tri.x[k] * tri.y[n] - tri.x[n] * tri.y[k];
+            }
+
+            // depth is affine in screen space: z(x, y) = z0 + dzdx * (x - x0) + dzdy * (y - y0)
+            auto area = a[0] * tri.x[2] + b[0] * tri.y[2] + c[0];
+            auto dzdx = (a[1] * tri.z[0] + a[2] * tri.z[1] + a[0] * tri.z[2]) / area;
+            auto dzdy = (b[1] * tri.z[0] + b[2] * tri.z[1] + b[0] * tri.z[2]) / area;
+            auto z0 = tri.z[0] - dzdx * tri.x[0] - dzdy * tri.y[0];
+
+            // isVisible() treats a pixel as blocked everywhere, so only pixels the triangle covers
+            // completely may be written, and with the farthest depth found in them.
+            // both are the pixel center value pushed half a pixel towards the worst corner
+            for (int k = 0; k < 3; ++k) {
+                c[k] -= 0.5f * (std::fabs(a[k]) + std::fabs(b[k]));
+            }
+            z0 += 0.5f * (std::fabs(dzdx) + std::fabs(dzdy));
+
+            // clamp the triangle's bounding rectangle to the tile, x is aligned down to 4 for the SIMD loop
+            auto minX = toPixel(std::min({ tri.x[0], tri.x[1], tri.x[2] }), tileX, tileX + TILE_SIZE) & ~3;
+            auto maxX = toPixel(std::max({ tri.x[0], tri.x[1], tri.x[2] }), tileX - 1, std::min(tileX + TILE_SIZE, width) - 1);
+            auto minY = toPixel(std::min({ tri.y[0], tri.y[1], tri.y[2] }), tileY, tileY + TILE_SIZE);
+            auto maxY = toPixel(std::max({ tri.y[0], tri.y[1], tri.y[2] }), tileY - 1, std::min(tileY + TILE_SIZE, height) - 1);
+
+            for (int y = minY; y <= maxY; ++y) {
+                auto py = y + 0.5f;
+                auto row = &depthBuffer[y * stride];
+#ifdef EIRIKR_OCCLUSION_SIMD
+                auto offsets = lanes::set(0.5f, 1.5f, 2.5f, 3.5f);
+                auto zero = lanes::splat(0.0f);
+                for (int x = minX; x <= maxX; x += 4) {
+                    auto px = lanes::add(lanes::splat(static_cast<float>(x)), offsets);
+                    auto inside = lanes::greaterEqual(lanes::add(lanes::mul(lanes::splat(a[0]), px), lanes::splat(b[0] * py + c[0])), zero);
+                    for (int k = 1; k < 3; ++k) {
+                        auto e = lanes::add(lanes::mul(lanes::splat(a[k]), px), lanes::splat(b[k] * py + c[k]));
+                        inside = lanes::both(inside, lanes::greaterEqual(e, zero));
+                    }
+                    if (!lanes::any(inside)) continue;
+                    auto z = lanes::add(lanes::mul(lanes::splat(dzdx), px), lanes::splat(z0 + dzdy * py));
+                    auto stored = lanes::load(row + x);
+                    auto pass = lanes::both(inside, lanes::less(z, stored));
+                    lanes::store(row + x, lanes::select(pass, z, stored));
+                }
+#else
+                for (int x = minX; x <= maxX; ++x) {
+                    auto px = x + 0.5f;
+                    if (a[0] * px + b[0] * py + c[0] < 0.0f) continue;
+                    if (a[1] * px + b[1] * py + c[1] < 0.0f) continue;
+                    if (a[2] * px + b[2] * py + c[2] < 0.0f) continue;
+                    auto z = z0 + dzdx * px + dzdy * py;
+                    if (z < row[x]) row[x] = z;
+                }
+#endif
+            }
+        }
+    }
+
+    void OcclusionCuller::buildHiZ() {
+        // level 0 is the visible part of the depth buffer, every level above keeps
+        // the farthest depth of the 2x2 block below it
+        auto & base = hiZ[0];
+        for (int y = 0; y < height; ++y) {
+            std::copy(&depthBuffer[y * stride], &depthBuffer[y * stride] + width, &base[y * width]);
+        }
+        for (std::size_t level = 1; level < hiZ.size(); ++level) {
+            auto & src = hiZ[level - 1];
+            auto & dst = hiZ[level];
+            auto srcW = hiZWidth[level - 1], srcH = hiZHeight[level - 1];
+            auto dstW = hiZWidth[level], dstH = hiZHeight[level];
+            for (int y = 0; y < dstH; ++y) {
+                auto y0 = 2 * y, y1 = std::min(2 * y + 1, srcH - 1);
+                for (int x = 0; x < dstW; ++x) {
+                    auto x0 = 2 * x, x1 = std::min(2 * x + 1, srcW - 1);
+                    dst[y * dstW + x] = std::max(std::max(src[y0 * srcW + x0], src[y0 * srcW + x1]),
+                                                 std::max(src[y1 * srcW + x0], src[y1 * srcW + x1]));
+                }
+            }
+        }
+    }
+
+    // tiles don't share pixels, so workers never touch the same memory
+    void OcclusionCuller::rasterizeTiles() {
+        auto tileCount = tilesX * tilesY;
+        for (int tile = nextTile++; tile < tileCount; tile = nextTile++) {
+            rasterizeTile(tile);
+        }
+    }
+
+    void OcclusionCuller::rasterize() {
+        nextTile = 0;
+        {
+            std::lock_guard<std::mutex> guard(poolLock);
+            busy = static_cast<unsigned int>(workers.size());
+            ++generation;
+        }
+        wake.notify_all();
+        rasterizeTiles();
+        {
+            std::unique_lock<std::mutex> guard(poolLock);
+            done.wait(guard, [this]() { return busy == 0; });
+        }
+        buildHiZ();
+    }
+
+    bool OcclusionCuller::isVisible(glm::vec3 const & boundsMin, glm::vec3 const & boundsMax, glm::mat4 const & model) const {
+        auto mvp = viewProjection * model;
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, minZ = 1e30f;
+        for (int i = 0; i < 8; ++i) {
+            glm::vec3 corner((i & 1) ? boundsMax.x : boundsMin.x,
+                             (i & 2) ? boundsMax.y : boundsMin.y,
+                             (i & 4) ? boundsMax.z : boundsMin.z);
+            auto c = mvp * glm::vec4(corner, 1.0f);
+            // the box crosses the near plane, we can't say anything about it
+            if (c.w <= 1e-5f || c.z < -c.w) return true;
+            auto sx = (c.x / c.w * 0.5f + 0.5f) * width;
+            auto sy = (c.y / c.w * 0.5f + 0.5f) * height;
+            auto sz = c.z / c.w * 0.5f + 0.5f;
+            minX = std::min(minX, sx); maxX = std::max(maxX, sx);
+            minY = std::min(minY, sy); maxY = std::max(maxY, sy);
+            minZ = std::min(minZ, sz);
+        }
+
+        if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height) return false; // off screen
+        if (minZ <= 0.0f) return true;
+
+        auto x0 = toPixel(minX, 0, width - 1);
+        auto x1 = toPixel(maxX, 0, width - 1);
+        auto y0 = toPixel(minY, 0, height - 1);
+        auto y1 = toPixel(maxY, 0, height - 1);
+
+        // climb the pyramid until the rectangle covers at most 4x4 texels
+        std::size_t level = 0;
+        while (level + 1 < hiZ.size() && (x1 - x0 > 3 || y1 - y0 > 3)) {
+            x0 >>= 1; x1 >>= 1; y0 >>= 1; y1 >>= 1;
+            ++level;
+        }
+
+        auto & depth = hiZ[level];
+        auto levelWidth = hiZWidth[level];
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                if (minZ <= depth[y * levelWidth + x]) return true;
+            }
+        }
+        return false;
+    }
+
+}
+
+#endif /* __OCCLUSION_HPP__ */
@@ -0,0 +1,236 @@
+#ifndef __RENDERQUEUE_HPP__
+#define __RENDERQUEUE_HPP__
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "mesh.hpp"
+
+namespace eirikr {
+
+    /* a compact description of a single glDrawElements call */
+    struct DrawPacket {
+        std::uint64_t key;
+        Mesh const * mesh;           // owner of the textures, may be null for untextured draws
+        glm::mat4 const * transform; // uploaded as the "model" uniform, must outlive replay()
+        unsigned int program;
+        unsigned int material;
+        unsigned int vao;
+        unsigned int indexCount;
+    };
+
+    /* the default backend, issues the real OpenGL calls
+     * replay() is a template over the backend, so a mock with the same
+     * member functions can count or log calls without a GL context.
+     */
+    struct GLRenderBackend {
+        void useProgram(unsigned int program) { glUseProgram(program); }
+        void bindMaterial(unsigned int program, Mesh const * mesh) { if (mesh) mesh->bindTextures(program); }
+        void bindVertexArray(unsigned int vao) { glBindVertexArray(vao); }
+        void setTransform(unsigned int program, glm::mat4 const & transform) {
+            glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, glm::value_ptr(transform));
+        }
+        void drawElements(unsigned int indexCount) { glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0); }
+        void finish() {
+            glBindVertexArray(0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+    };
+
+    /* render queue
+     * worker threads each record into their own Recorder (no locking, no sharing),
+     * sort() merges every recorder and radix sorts by key on the calling thread,
+     * replay() then walks the sorted packets on the GL thread and only touches
+     * program / texture / VAO state when it actually changes.
+     *
+     * key layout, most significant first:
+     * | program : 12 | material : 20 | vao : 16 | depth : 16 |
+     * fields wider than their slot are truncated, which only costs sorting quality;
+     * replay() always compares the full values.
+     */
+    class RenderQueue {
+    public:
+        struct Stats {
+            unsigned int draws;
+            unsigned int programChanges;
+            unsigned int materialChanges;
+            unsigned int vaoChanges;
+        };
+
+        // a cache line each, neighbouring threads pushing into their own recorders
+        // would otherwise keep invalidating each other's vector end pointer
+        class alignas(64) Recorder {
+        private:
+            std::vector<DrawPacket> packets;
+            friend class RenderQueue;
+
+        public:
+            void submit(unsigned int program, unsigned int material, unsigned int vao, unsigned int indexCount,
+                        float depth, Mesh const * mesh = nullptr, glm::mat4 const * transform = nullptr);
+            void submit(Mesh const & mesh, unsigned int program, float depth, glm::mat4 const * transform = nullptr);
+            std::size_t size() const { return packets.size(); }
+        };
+
+    private:
+        struct SortEntry {
+            std::uint64_t key;
+            unsigned int index;
+        };
+
+        std::vector<Recorder> recorders;
+        std::vector<DrawPacket> packets;
+        std::vector<SortEntry> entries;
+        std::vector<SortEntry> scratch;
+
+    private:
+        void radixSort();
+
+    public:
+        RenderQueue(unsigned int threads = 1) : recorders(threads) {}
+
+        static std::uint64_t makeKey(unsigned int program, unsigned int material, unsigned int vao, float depth);
+
+        void reset(unsigned int threads, std::size_t packetsPerThread = 0);
+        Recorder & getRecorder(unsigned int thread) { return recorders[thread]; }
+        unsigned int getRecorderCount() const { return static_cast<unsigned int>(recorders.size()); }
+        void sort();
+        std::vector<DrawPacket> const & getPackets() const { return packets; }
+        template<typename Backend> Stats replay(Backend & backend) const;
+        Stats replay() const;
+    };
+
+    void RenderQueue::Recorder::submit(unsigned int program, unsigned int material, unsigned int vao, unsigned int indexCount,
+                                       float depth, Mesh const * mesh, glm::mat4 const * transform) {
+        DrawPacket packet;
+        packet.key = makeKey(program, material, vao, depth);
+        packet.mesh = mesh;
+        packet.transform = transform;
+        packet.program = program;
+        packet.material = material;
+        packet.vao = vao;
+        packet.indexCount = indexCount;
+        packets.push_back(packet);
+    }
+
+    void RenderQueue::Recorder::submit(Mesh const & mesh, unsigned int program, float depth, glm::mat4 const * transform) {
+        submit(program, mesh.materialID, mesh.getVAO(), static_cast<unsigned int>(mesh.indices.size()), depth, &mesh, transform);
+    }
+
+    // depth is expected in [0, 1], smaller is nearer, so opaque draws go front to back
+    std::uint64_t RenderQueue::makeKey(unsigned int program, unsigned int material, unsigned int vao, float depth) {
+        depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+        auto quantized = static_cast<std::uint64_t>(depth * 65535.0f);
+        return (static_cast<std::uint64_t>(program & 0xfff) << 52) |
+               (static_cast<std::uint64_t>(material & 0xfffff) << 32) |
+               (static_cast<std::uint64_t>(vao & 0xffff) << 16) |
+               quantized;
+    }
+
+    // packetsPerThread reserves up front, so recording doesn't reallocate in the first frames
+    void RenderQueue::reset(unsigned int threads, std::size_t packetsPerThread) {
+        recorders.resize(threads);
+        for (auto & recorder : recorders) {
+            recorder.packets.clear();
+            recorder.packets.reserve(packetsPerThread);
+        }
+        packets.clear();
+        entries.clear();
+    }
+
+    void RenderQueue::sort() {
+        packets.clear();
+        entries.clear();
+        std::size_t total = 0;
+        for (auto const & recorder : recorders) {
+            total += recorder.packets.size();
+        }
+        packets.reserve(total);
+        entries.reserve(total);
+        for (auto & recorder : recorders) {
+            packets.insert(packets.end(), recorder.packets.begin(), recorder.packets.end());
+            recorder.packets.clear();
+        }
+        for (unsigned int i = 0; i < packets.size(); ++i) {
+            entries.push_back({ packets[i].key, i });
+        }
+        radixSort();
+
+        // reorder the packets themselves so replay walks memory linearly
+        std::vector<DrawPacket> sorted;
+        sorted.reserve(packets.size());
+        for (auto const & entry : entries) {
+            sorted.push_back(packets[entry.index]);
+        }
+        packets.swap(sorted);
+    }
+
+    // LSD radix sort on the 64-bit key, one byte per pass.
+    // a pass is skipped when every key has the same byte there, which is common
+    // for the upper program bits, so a typical frame only needs a few passes.
+    void RenderQueue::radixSort() {
+        scratch.resize(entries.size());
+        for (int pass = 0; pass < 8; ++pass) {
+            auto shift = pass * 8;
+            std::size_t counts[256] = { 0 };
+            for (auto const & entry : entries) {
+                ++counts[(entry.key >> shift) & 0xff];
+            }
+            if (entries.empty() || counts[(entries[0].key >> shift) & 0xff] == entries.size()) continue;
+
+            std::size_t offset = 0;
+            for (int i = 0; i < 256; ++i) {
+                auto count = counts[i];
+                counts[i] = offset;
+                offset += count;
+            }
+            for (auto const & entry : entries) {
+                scratch[counts[(entry.key >> shift) & 0xff]++] = entry;
+            }
+            entries.swap(scratch);
+        }
+    }
+
+    template<typename Backend>
+    RenderQueue::Stats RenderQueue::replay(Backend & backend) const {
+        Stats stats = { 0, 0, 0, 0 };
+        bool first = true;
+        unsigned int program = 0, material = 0, vao = 0;
+        for (auto const & packet : packets) {
+            // sampler uniforms are program state, so a new program invalidates the bound material
+            bool programChanged = first || packet.program != program;
+            if (programChanged) {
+                backend.useProgram(packet.program);
+                program = packet.program;
+                ++stats.programChanges;
+            }
+            if (programChanged || packet.material != material) {
+                backend.bindMaterial(packet.program, packet.mesh);
+                material = packet.material;
+                ++stats.materialChanges;
+            }
+            if (first || packet.vao != vao) {
+                backend.bindVertexArray(packet.vao);
+                vao = packet.vao;
+                ++stats.vaoChanges;
+            }
+            if (packet.transform) {
+                backend.setTransform(packet.program, *packet.transform);
+            }
+            backend.drawElements(packet.indexCount);
+            ++stats.draws;
+            first = false;
+        }
+        if (!first) backend.finish();
+        return stats;
+    }
+
+    RenderQueue::Stats RenderQueue::replay() const {
+        GLRenderBackend backend;
+        return replay(backend);
+    }
+
+}
+
+#endif /* __RENDERQUEUE_HPP__ */
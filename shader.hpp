@@ -17,6 +17,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "assetpack.hpp"
 
 namespace eirikr {
     
@@ -24,10 +25,12 @@ namespace eirikr {
     private:
         template<typename T> void printCompileError(T);
         template<typename T> void printLinkError(T);
+        void compile(const char * vShaderCode, const char * fShaderCode);
         
     public:
         GLuint ID;
         Shader(const GLchar* vertexPath, const GLchar* fragmentPath);
+        Shader(const GLchar* vertexPath, const GLchar* fragmentPath, AssetPack const & pack);
         void use();
         void setBool(const std::string &name, bool value) const;
         void setInt(const std::string & name, int value) const;
@@ -81,9 +84,23 @@ namespace eirikr {
             std::cout << "ERROR::SHADER::FAIL_NOT_SUCCESSFULLY_READ" << std::endl;
         }
         
-        const char * vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        
+        compile(vertexCode.c_str(), fragmentCode.c_str());
+    }
+    
+    // sources the pack doesn't hold fall back to the files on disk
+    Shader::Shader(const GLchar * vertexPath, const GLchar * fragmentPath, AssetPack const & pack) {
+        auto vBlob = pack.find(vertexPath);
+        auto fBlob = pack.find(fragmentPath);
+        if (!vBlob.data || !fBlob.data) {
+            *this = Shader(vertexPath, fragmentPath);
+            return;
+        }
+        std::string vertexCode(reinterpret_cast<const char *>(vBlob.data), vBlob.size);
+        std::string fragmentCode(reinterpret_cast<const char *>(fBlob.data), fBlob.size);
+        compile(vertexCode.c_str(), fragmentCode.c_str());
+    }
+    
+    void Shader::compile(const char * vShaderCode, const char * fShaderCode) {
         auto vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, nullptr);
         glCompileShader(vertex);
@@ -6,6 +6,7 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <stb/stb_image.h>
+#include "assetpack.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -22,14 +23,30 @@ namespace eirikr {
         
     public:
         Texture() {}
-        unsigned int loadTextureFromPath(const char * path);
+        unsigned int loadTextureFromPath(const char * path, AssetPack const * pack = nullptr);
+        
+    private:
+        unsigned int upload(unsigned char * data, const char * path);
     };
     
-    unsigned int Texture::loadTextureFromPath(const char * path) {
+    // resolves `path` through `pack` first and decodes straight out of the mapping,
+    // anything the pack doesn't hold is read from disk as before
+    unsigned int Texture::loadTextureFromPath(const char * path, AssetPack const * pack) {
 //        stbi_set_flip_vertically_on_load(true);
+        unsigned char * data = nullptr;
+        auto blob = pack ? pack->find(path) : AssetPack::Blob{ nullptr, 0 };
+        if (blob.data) {
+            data = stbi_load_from_memory(blob.data, static_cast<int>(blob.size), &texWidth, &texHeight, &texComponents, 0);
+        }
+        else {
+            data = stbi_load(path, &texWidth, &texHeight, &texComponents, 0);
+        }
+        return upload(data, path);
+    }
+    
+    unsigned int Texture::upload(unsigned char * data, const char * path) {
         unsigned int textureID;
         glGenTextures(1, &textureID);
-        auto data = stbi_load(path, &texWidth, &texHeight, &texComponents, 0);
         if (data) {
             GLenum format;
             if (texComponents == 1) format = GL_RED;
@@ -0,0 +1,311 @@
+#ifndef __TEXTUREARRAY_HPP__
+#define __TEXTUREARRAY_HPP__
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+namespace eirikr {
+
+    /* where a packed texture ended up
+     * sample it with texture(pages[page], vec3(uv * rect.zw + rect.xy, layer))
+     */
+    struct TexturePlacement {
+        unsigned int page;
+        unsigned int layer;
+        glm::vec4 rect; // xy: uv offset, zw: uv scale
+    };
+
+    /* one GL_TEXTURE_2D_ARRAY worth of pixels
+     * atlas pages are composed on the CPU, their layers are stored back to back in `pixels`.
+     * array pages hold whole textures per layer, so they only remember which source each
+     * layer comes from and upload() copies it straight from there.
+     */
+    struct TexturePage {
+        int width;
+        int height;
+        int components;
+        int layers;
+        int maxLevel; // highest mip level that is safe to sample, -1 for the full chain
+        bool atlas;   // true if layers hold several textures each (clamped, no GL_REPEAT)
+        std::vector<unsigned char> pixels;      // atlas pages only
+        std::vector<unsigned int> layerSources; // array pages only, the add() handle of every layer
+    };
+
+    /* texture packer
+     * textures sharing size and component count become layers of one array page;
+     * the leftovers are shelf-packed into fixed-size atlas pages with gutters
+     * around every cell. cells are `gutter`-aligned and everything in a cell around
+     * the texture replicates its border texels, so mip levels up to log2(gutter)
+     * never mix neighbouring textures. atlased textures can't use GL_REPEAT, so
+     * anything added with `repeat` set only ever goes into array pages.
+     * every page takes a texture unit, so at most `maxPages` are made; array groups
+     * with the most layers win, the rest fall back to the atlases where they can and
+     * are left out (placement page UNPACKED) where they can't.
+     * everything but upload() is plain CPU work. array layers are read from the
+     * added pixels at upload() time, so those have to stay alive until then.
+     */
+    class TexturePacker {
+    public:
+        static const unsigned int UNPACKED = ~0u;
+
+    private:
+        struct Source {
+            int width;
+            int height;
+            int components;
+            bool repeat; // sampled with uvs outside [0, 1], keep it out of the atlases
+            unsigned char const * pixels; // not owned, must stay valid until upload() returns
+        };
+
+        int atlasSize;
+        int gutter;
+        int maxLayers;
+        unsigned int maxPages;
+        std::vector<Source> sources;
+        std::vector<TexturePlacement> placements;
+        std::vector<TexturePage> pages;
+
+    private:
+        void packArrays(std::vector<unsigned int> & leftovers);
+        void packAtlases(std::vector<unsigned int> const & leftovers);
+        void blit(TexturePage & page, int layer, int cellX, int cellY, int cellWidth, int cellHeight,
+                  int x, int y, Source const & source);
+
+    public:
+        TexturePacker(int atlasSize = 2048, int gutter = 8, int maxLayers = 256, unsigned int maxPages = 16);
+
+        unsigned int add(int width, int height, int components, unsigned char const * pixels, bool repeat = false);
+        void pack();
+        std::vector<unsigned int> upload() const;
+
+        std::vector<TexturePage> const & getPages() const { return pages; }
+        TexturePlacement const & getPlacement(unsigned int handle) const { return placements.at(handle); }
+        std::size_t size() const { return sources.size(); }
+    };
+
+    TexturePacker::TexturePacker(int atlasSize, int gutter, int maxLayers, unsigned int maxPages) {
+        // alignment is done in steps of the gutter, so keep it a power of two
+        int g = 1;
+        while (g < gutter) g <<= 1;
+        this->atlasSize = atlasSize;
+        this->gutter = g;
+        this->maxLayers = maxLayers;
+        this->maxPages = maxPages;
+    }
+
+    unsigned int TexturePacker::add(int width, int height, int components, unsigned char const * pixels, bool repeat) {
+        if (width <= 0 || height <= 0 || components < 1 || components > 4 || !pixels) {
+            throw std::logic_error("Error: cannot pack a texture without pixels\n");
+        }
+        sources.push_back({ width, height, components, repeat, pixels });
+        return static_cast<unsigned int>(sources.size() - 1);
+    }
+
+    void TexturePacker::pack() {
+        pages.clear();
+        placements.assign(sources.size(), { UNPACKED, 0, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) });
+        std::vector<unsigned int> leftovers;
+        packArrays(leftovers);
+        packAtlases(leftovers);
+    }
+
+    // copies `source` to (x, y) of `layer` and fills the rest of its cell with the nearest border texel,
+    // the whole aligned cell has to be covered or the top mip levels pull in whatever is left around it
+    void TexturePacker::blit(TexturePage & page, int layer, int cellX, int cellY, int cellWidth, int cellHeight,
+                             int x, int y, Source const & source) {
+        auto c = page.components;
+        auto base = &page.pixels[static_cast<std::size_t>(layer) * page.width * page.height * c];
+        auto right = std::min(cellX + cellWidth, page.width);
+        auto bottom = std::min(cellY + cellHeight, page.height);
+        for (int dstY = cellY; dstY < bottom; ++dstY) {
+            auto srcY = std::min(std::max(dstY - y, 0), source.height - 1);
+            auto src = source.pixels + static_cast<std::size_t>(srcY) * source.width * c;
+            auto row = base + static_cast<std::size_t>(dstY) * page.width * c;
+            std::memcpy(row + static_cast<std::size_t>(x) * c, src, static_cast<std::size_t>(source.width) * c);
+            for (int dstX = cellX; dstX < x; ++dstX) {
+                std::memcpy(row + static_cast<std::size_t>(dstX) * c, src, c);
+            }
+            for (int dstX = x + source.width; dstX < right; ++dstX) {
+                std::memcpy(row + static_cast<std::size_t>(dstX) * c, src + (source.width - 1) * c, c);
+            }
+        }
+    }
+
+    void TexturePacker::packArrays(std::vector<unsigned int> & leftovers) {
+        std::map<std::tuple<int, int, int>, std::vector<unsigned int>> groups;
+        for (unsigned int i = 0; i < sources.size(); ++i) {
+            groups[std::make_tuple(sources[i].components, sources[i].width, sources[i].height)].push_back(i);
+        }
+
+        auto fitsAtlas = [this](Source const & source) {
+            return !source.repeat && source.width + 2 * gutter <= atlasSize && source.height + 2 * gutter <= atlasSize;
+        };
+
+        // every chunk of up to maxLayers same-sized textures is one candidate array page,
+        // lone textures go to the atlases, unless they wouldn't fit there or have to repeat
+        std::vector<std::vector<unsigned int>> chunks;
+        for (auto const & group : groups) {
+            auto & members = group.second;
+            if (members.size() == 1 && fitsAtlas(sources[members[0]])) {
+                leftovers.push_back(members[0]);
+                continue;
+            }
+            for (std::size_t start = 0; start < members.size(); start += maxLayers) {
+                auto end = std::min(members.size(), start + static_cast<std::size_t>(maxLayers));
+                chunks.push_back(std::vector<unsigned int>(members.begin() + start, members.begin() + end));
+            }
+        }
+        std::stable_sort(chunks.begin(), chunks.end(), [](std::vector<unsigned int> const & a, std::vector<unsigned int> const & b) {
+            return a.size() > b.size();
+        });
+
+        // keep a page for every atlas format that could be needed, the arrays get what's left
+        std::vector<int> formats;
+        for (auto const & source : sources) {
+            if (fitsAtlas(source) && std::find(formats.begin(), formats.end(), source.components) == formats.end()) {
+                formats.push_back(source.components);
+            }
+        }
+        auto arrayBudget = maxPages > formats.size() ? maxPages - formats.size() : 0;
+
+        for (auto const & chunk : chunks) {
+            if (pages.size() >= arrayBudget) {
+                for (auto index : chunk) {
+                    if (fitsAtlas(sources[index])) leftovers.push_back(index);
+                }
+                continue;
+            }
+            auto & first = sources[chunk[0]];
+            TexturePage page;
+            page.width = first.width;
+            page.height = first.height;
+            page.components = first.components;
+            page.layers = static_cast<int>(chunk.size());
+            page.maxLevel = -1;
+            page.atlas = false;
+            page.layerSources = chunk;
+            for (std::size_t layer = 0; layer < chunk.size(); ++layer) {
+                auto index = chunk[layer];
+                placements[index] = { static_cast<unsigned int>(pages.size()), static_cast<unsigned int>(layer),
+                                      glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) };
+            }
+            pages.push_back(std::move(page));
+        }
+    }
+
+    void TexturePacker::packAtlases(std::vector<unsigned int> const & leftovers) {
+        // one set of atlas layers per component count
+        std::map<int, std::vector<unsigned int>> byFormat;
+        for (auto index : leftovers) {
+            byFormat[sources[index].components].push_back(index);
+        }
+
+        auto align = [this](int v) { return (v + gutter - 1) & ~(gutter - 1); };
+        for (auto & format : byFormat) {
+            if (pages.size() >= maxPages) break; // out of units, the rest stay UNPACKED
+            auto & members = format.second;
+            // tallest first keeps the shelves tight
+            std::sort(members.begin(), members.end(), [this](unsigned int a, unsigned int b) {
+                return sources[a].height > sources[b].height;
+            });
+
+            // shelf packing: cells go left to right, a new shelf starts under the tallest cell of the last one
+            struct Cell { unsigned int index; int layer; int x; int y; int width; int height; };
+            std::vector<Cell> cells;
+            int layer = 0, x = 0, y = 0, shelfHeight = 0, usedHeight = 0;
+            for (auto index : members) {
+                auto w = align(sources[index].width + 2 * gutter);
+                auto h = align(sources[index].height + 2 * gutter);
+                if (x + w > atlasSize) {
+                    x = 0;
+                    y += shelfHeight;
+                    shelfHeight = 0;
+                }
+                if (y + h > atlasSize) {
+                    ++layer;
+                    x = y = shelfHeight = 0;
+                }
+                cells.push_back({ index, layer, x, y, w, h });
+                x += w;
+                shelfHeight = std::max(shelfHeight, h);
+                usedHeight = std::max(usedHeight, y + shelfHeight);
+            }
+
+            TexturePage page;
+            page.width = atlasSize;
+            page.height = atlasSize;
+            // a single layer doesn't need the whole square, trim it to the next power of two
+            if (layer == 0) {
+                page.height = 1;
+                while (page.height < usedHeight) page.height <<= 1;
+            }
+            page.components = format.first;
+            page.layers = layer + 1;
+            page.maxLevel = 0;
+            for (int g = gutter; g > 1; g >>= 1) ++page.maxLevel;
+            page.atlas = true;
+            page.pixels.assign(static_cast<std::size_t>(page.width) * page.height * page.components * page.layers, 0);
+
+            auto pageIndex = static_cast<unsigned int>(pages.size());
+            for (auto const & cell : cells) {
+                auto & source = sources[cell.index];
+                blit(page, cell.layer, cell.x, cell.y, cell.width, cell.height, cell.x + gutter, cell.y + gutter, source);
+                placements[cell.index] = { pageIndex, static_cast<unsigned int>(cell.layer),
+                                           glm::vec4(static_cast<float>(cell.x + gutter) / page.width,
+                                                     static_cast<float>(cell.y + gutter) / page.height,
+                                                     static_cast<float>(source.width) / page.width,
+                                                     static_cast<float>(source.height) / page.height) };
+            }
+            pages.push_back(std::move(page));
+        }
+    }
+
+    // creates one GL_TEXTURE_2D_ARRAY per page, in page order
+    // array pages are allocated empty and filled a layer at a time from the sources, without a CPU copy
+    std::vector<unsigned int> TexturePacker::upload() const {
+        std::vector<unsigned int> ids(pages.size());
+        if (!pages.empty()) glGenTextures(static_cast<GLsizei>(ids.size()), &ids[0]);
+        for (std::size_t i = 0; i < pages.size(); ++i) {
+            auto & page = pages[i];
+            GLenum format = GL_RED;
+            if (page.components == 2) format = GL_RG;
+            else if (page.components == 3) format = GL_RGB;
+            else if (page.components == 4) format = GL_RGBA;
+            glBindTexture(GL_TEXTURE_2D_ARRAY, ids[i]);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            if (page.atlas) {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, page.width, page.height, page.layers, 0, format,
+                             GL_UNSIGNED_BYTE, &page.pixels[0]);
+            }
+            else {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, page.width, page.height, page.layers, 0, format,
+                             GL_UNSIGNED_BYTE, nullptr);
+                for (std::size_t layer = 0; layer < page.layerSources.size(); ++layer) {
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(layer), page.width, page.height, 1,
+                                    format, GL_UNSIGNED_BYTE, sources[page.layerSources[layer]].pixels);
+                }
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            if (page.maxLevel >= 0) glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, page.maxLevel);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+            auto wrap = page.atlas ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return ids;
+    }
+
+}
+
+#endif /* __TEXTUREARRAY_HPP__ */
@@ -0,0 +1,142 @@
+//
+//  assetbench.cpp
+//  cold-cache load time of an asset pack against the same files loaded loose
+//
+//  usage: assetbench <assets.pak> <file> [file ...]
+//  the files are read by the path they're given as, and looked up in the pack
+//  under the same path, so pass the same list assetpacker was given.
+//  before every run the page cache is dropped for the pack and every loose file
+//  (posix_fadvise DONTNEED on Linux, `purge` on macOS which needs root), so both
+//  sides start cold. loading means reading every byte, the part decoders see.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../assetpack.hpp"
+
+namespace {
+    void dropCache(std::vector<std::string> const & paths) {
+#if defined(__APPLE__)
+        (void)paths;
+        if (std::system("purge > /dev/null 2>&1") != 0) {
+            std::cout << "warning: purge failed (needs root), runs may be warm" << std::endl;
+        }
+#elif !defined(_WIN32)
+        for (auto const & path : paths) {
+            auto fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) continue;
+            fdatasync(fd);
+            if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0) {
+                std::cout << "warning: couldn't drop the cache for " << path << std::endl;
+            }
+            close(fd);
+        }
+#else
+        (void)paths;
+        std::cout << "warning: no way to drop the cache here, runs may be warm" << std::endl;
+#endif
+    }
+
+    // reads every byte, the sum makes sure nothing gets optimised away and both sides saw the same data
+    unsigned long long touch(unsigned char const * data, std::size_t size) {
+        unsigned long long sum = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            sum += data[i];
+        }
+        return sum;
+    }
+
+    // the way the loaders read a loose file: size it up front, then one read into a buffer that size
+    unsigned long long loadLoose(std::vector<std::string> const & files) {
+        unsigned long long sum = 0;
+        std::vector<unsigned char> bytes;
+        for (auto const & file : files) {
+#ifndef _WIN32
+            auto fd = open(file.c_str(), O_RDONLY);
+            if (fd < 0) continue;
+            struct stat info;
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                bytes.resize(static_cast<std::size_t>(info.st_size));
+                std::size_t done = 0;
+                while (done < bytes.size()) {
+                    auto got = read(fd, &bytes[done], bytes.size() - done);
+                    if (got <= 0) break;
+                    done += static_cast<std::size_t>(got);
+                }
+                sum += touch(&bytes[0], done);
+            }
+            close(fd);
+#else
+            std::ifstream stream(file, std::ios::binary | std::ios::ate);
+            auto size = static_cast<std::size_t>(stream.tellg());
+            if (!stream || !size) continue;
+            bytes.resize(size);
+            stream.seekg(0);
+            stream.read(reinterpret_cast<char *>(&bytes[0]), size);
+            sum += touch(&bytes[0], static_cast<std::size_t>(stream.gcount()));
+#endif
+        }
+        return sum;
+    }
+
+    unsigned long long loadPacked(const char * packPath, std::vector<std::string> const & files) {
+        eirikr::AssetPack pack(packPath);
+        pack.prefetch(files);
+        unsigned long long sum = 0;
+        for (auto const & file : files) {
+            auto blob = pack.find(file);
+            if (blob.data) sum += touch(blob.data, blob.size);
+        }
+        return sum;
+    }
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 3) {
+        std::cout << "usage: " << argv[0] << " <assets.pak> <file> [file ...]" << std::endl;
+        return 1;
+    }
+    const int runs = 5;
+    std::vector<std::string> files(argv + 2, argv + argc);
+    std::vector<std::string> everything(files);
+    everything.push_back(argv[1]);
+
+    try {
+        std::vector<double> loose, packed;
+        for (int run = 0; run < runs; ++run) {
+            dropCache(everything);
+            auto start = std::chrono::steady_clock::now();
+            auto looseSum = loadLoose(files);
+            loose.push_back(millisecondsSince(start));
+
+            dropCache(everything);
+            start = std::chrono::steady_clock::now();
+            auto packedSum = loadPacked(argv[1], files);
+            packed.push_back(millisecondsSince(start));
+
+            if (looseSum != packedSum) {
+                std::cout << "Error: the pack doesn't hold the same bytes as the loose files" << std::endl;
+                return 1;
+            }
+        }
+        std::sort(loose.begin(), loose.end());
+        std::sort(packed.begin(), packed.end());
+        std::cout << files.size() << " files, median of " << runs << " cold runs" << std::endl;
+        std::cout << "loose: " << loose[runs / 2] << " ms" << std::endl;
+        std::cout << "pack:  " << packed[runs / 2] << " ms" << std::endl;
+    }
+    catch (std::logic_error const & e) {
+        std::cout << e.what();
+        return 1;
+    }
+    return 0;
+}
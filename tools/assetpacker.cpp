@@ -0,0 +1,32 @@
+//
+//  assetpacker.cpp
+//  packs loose asset files into a single asset pack
+//
+//  usage: assetpacker <output.pak> <file> [file ...]
+//  files are stored under the path they're given as, so run it from the directory
+//  the program loads its assets relative to, e.g.
+//      assetpacker assets.pak models/nanosuit/* shaders/*.vs shaders/*.fs
+//
+
+#include <iostream>
+#include "../assetpack.hpp"
+
+int main(int argc, char ** argv) {
+    if (argc < 3) {
+        std::cout << "usage: " << argv[0] << " <output.pak> <file> [file ...]" << std::endl;
+        return 1;
+    }
+    try {
+        eirikr::AssetPackWriter writer;
+        for (int i = 2; i < argc; ++i) {
+            writer.addFile(argv[i], argv[i]);
+        }
+        writer.write(argv[1]);
+    }
+    catch (std::logic_error const & e) {
+        std::cout << e.what();
+        return 1;
+    }
+    std::cout << "packed " << argc - 2 << " files into " << argv[1] << std::endl;
+    return 0;
+}
@@ -0,0 +1,145 @@
+//
+//  occlusionbench.cpp
+//  addOccluder + rasterize + isVisible throughput of OcclusionCuller on a synthetic scene
+//
+//  usage: occlusionbench [threads] [walls] [boxes] [frames]
+//  needs the same include setup as the headers themselves (glm, camera.hpp),
+//  but nothing in the culler touches GL, so it runs without a context.
+//  before timing anything, a few boxes with a known answer (hidden, visible,
+//  crossing the near plane, just past an occluder's silhouette) are checked,
+//  and the run fails if any of them comes out wrong.
+//
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include "../occlusion.hpp"
+
+namespace {
+    double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // screen pixel -> normalized device coordinate, for layouts set up with an identity view-projection
+    float ndcX(float px, int width) { return px / width * 2.0f - 1.0f; }
+    float ndcY(float py, int height) { return py / height * 2.0f - 1.0f; }
+
+    bool expect(char const * name, bool visible, bool expected) {
+        if (visible == expected) return true;
+        std::cout << "Error: " << name << " box came out " << (visible ? "visible" : "hidden") << std::endl;
+        return false;
+    }
+
+    bool checkKnownBoxes(unsigned int threads) {
+        bool ok = true;
+        glm::mat4 identity(1.0f);
+        eirikr::OcclusionCuller culler(256, 128, threads);
+
+        // one triangle wide enough to cover the whole screen at z = -5, so none of its edges are on screen
+        auto projection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f);
+        culler.setViewProjection(projection);
+        std::vector<glm::vec3> wall = { { -100.0f, -100.0f, -5.0f }, { 100.0f, -100.0f, -5.0f }, { 0.0f, 100.0f, -5.0f } };
+        std::vector<unsigned int> triangle = { 0, 1, 2 };
+        culler.addOccluder(wall, triangle, identity);
+        culler.rasterize();
+        ok &= expect("hidden", culler.isVisible({ -1.0f, -1.0f, -12.0f }, { 1.0f, 1.0f, -10.0f }, identity), false);
+        ok &= expect("large hidden", culler.isVisible({ -6.0f, -3.0f, -20.0f }, { 6.0f, 3.0f, -10.0f }, identity), false);
+        ok &= expect("visible", culler.isVisible({ -1.0f, -1.0f, -4.0f }, { 1.0f, 1.0f, -3.0f }, identity), true);
+        ok &= expect("intersecting", culler.isVisible({ -1.0f, -1.0f, -6.0f }, { 1.0f, 1.0f, -4.0f }, identity), true);
+        ok &= expect("near plane crossing", culler.isVisible({ -1.0f, -1.0f, -12.0f }, { 1.0f, 1.0f, 1.0f }, identity), true);
+        ok &= expect("off screen", culler.isVisible({ 100.0f, -1.0f, -12.0f }, { 101.0f, 1.0f, -10.0f }, identity), false);
+
+        // an occluder edge at x = 128.6 px, a box behind it in 128.7 - 128.9 px: the box shares pixel 128
+        // with the occluder, whose center is covered, but is outside the occluder itself
+        culler.clear();
+        culler.setViewProjection(identity);
+        auto w = culler.getWidth(), h = culler.getHeight();
+        std::vector<glm::vec3> edge = { { ndcX(128.6f, w), -3.0f, 0.0f }, { ndcX(128.6f, w), 3.0f, 0.0f }, { -3.0f, 0.0f, 0.0f } };
+        culler.addOccluder(edge, triangle, identity);
+        culler.rasterize();
+        ok &= expect("silhouette", culler.isVisible({ ndcX(128.7f, w), ndcY(64.2f, h), 0.5f },
+                                                    { ndcX(128.9f, w), ndcY(64.8f, h), 0.6f }, identity), true);
+        ok &= expect("behind silhouette", culler.isVisible({ ndcX(100.0f, w), ndcY(50.0f, h), 0.5f },
+                                                           { ndcX(120.0f, w), ndcY(70.0f, h), 0.6f }, identity), false);
+        return ok;
+    }
+}
+
+int main(int argc, char ** argv) {
+    unsigned int threads = argc > 1 ? std::atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    unsigned int walls = argc > 2 ? std::atoi(argv[2]) : 2000;
+    unsigned int boxes = argc > 3 ? std::atoi(argv[3]) : 10000;
+    unsigned int frames = argc > 4 ? std::atoi(argv[4]) : 50;
+    if (!threads || !walls || !boxes || !frames) {
+        std::cout << "usage: " << argv[0] << " [threads] [walls] [boxes] [frames]" << std::endl;
+        return 1;
+    }
+    if (!checkKnownBoxes(threads)) return 1;
+
+    // a city-like spread: upright wall quads and small boxes scattered in front of the camera
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    std::vector<glm::vec3> boxMin, boxMax;
+    unsigned int seed = 2654435761u;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / 16777216.0f;
+    };
+    for (unsigned int i = 0; i < walls; ++i) {
+        glm::vec3 origin((next() - 0.5f) * 200.0f, 0.0f, -5.0f - next() * 150.0f);
+        auto width = 2.0f + next() * 10.0f, height = 2.0f + next() * 8.0f;
+        auto base = static_cast<unsigned int>(positions.size());
+        positions.push_back(origin);
+        positions.push_back(origin + glm::vec3(width, 0.0f, 0.0f));
+        positions.push_back(origin + glm::vec3(width, height, 0.0f));
+        positions.push_back(origin + glm::vec3(0.0f, height, 0.0f));
+        for (auto k : { 0u, 1u, 2u, 0u, 2u, 3u }) {
+            indices.push_back(base + k);
+        }
+    }
+    for (unsigned int i = 0; i < boxes; ++i) {
+        glm::vec3 origin((next() - 0.5f) * 200.0f, next() * 4.0f, -5.0f - next() * 150.0f);
+        boxMin.push_back(origin);
+        auto size = 0.5f + next() * 2.0f;
+        boxMax.push_back(origin + glm::vec3(size, size, size));
+    }
+
+    eirikr::OcclusionCuller culler(256, 128, threads);
+    auto projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+    glm::mat4 identity(1.0f);
+    double addTime = 0.0, rasterizeTime = 0.0, testTime = 0.0;
+    unsigned int visible = 0;
+
+    for (unsigned int frame = 0; frame < frames; ++frame) {
+        // sway the camera a little so every frame rasterizes something different
+        auto eye = glm::vec3(std::sin(frame * 0.1f) * 5.0f, 2.0f, 0.0f);
+        culler.clear();
+        culler.setViewProjection(projection * glm::lookAt(eye, eye + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+        auto start = std::chrono::steady_clock::now();
+        culler.addOccluder(positions, indices, identity);
+        addTime += millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        culler.rasterize();
+        rasterizeTime += millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        visible = 0;
+        for (unsigned int i = 0; i < boxes; ++i) {
+            if (culler.isVisible(boxMin[i], boxMax[i], identity)) ++visible;
+        }
+        testTime += millisecondsSince(start);
+    }
+
+    std::cout << threads << " threads, " << walls * 2 << " occluder triangles, " << boxes << " boxes, "
+              << frames << " frames" << std::endl;
+    std::cout << "addOccluder: " << addTime / frames << " ms/frame (" << culler.getOccluderTriangleCount()
+              << " triangles binned)" << std::endl;
+    std::cout << "rasterize:   " << rasterizeTime / frames << " ms/frame" << std::endl;
+    std::cout << "isVisible:   " << testTime / frames << " ms/frame, " << boxes * static_cast<double>(frames) / testTime / 1000.0
+              << " Mboxes/s" << std::endl;
+    std::cout << "last frame: " << visible << " of " << boxes << " boxes visible" << std::endl;
+    return 0;
+}
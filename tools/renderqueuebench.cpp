@@ -0,0 +1,108 @@
+//
+//  renderqueuebench.cpp
+//  record + sort + replay throughput of RenderQueue against a counting mock GL
+//
+//  usage: renderqueuebench [threads] [packets per thread] [frames]
+//  needs the same include setup as the headers themselves (glad, glm, headers.hpp),
+//  but never creates a GL context, the mock backend only counts calls.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include "../renderqueue.hpp"
+
+namespace {
+    // same members as eirikr::GLRenderBackend, no GL behind them
+    struct CountingBackend {
+        unsigned long long programs = 0;
+        unsigned long long materials = 0;
+        unsigned long long vaos = 0;
+        unsigned long long transforms = 0;
+        unsigned long long draws = 0;
+        unsigned long long indices = 0;
+
+        void useProgram(unsigned int) { ++programs; }
+        void bindMaterial(unsigned int, eirikr::Mesh const *) { ++materials; }
+        void bindVertexArray(unsigned int) { ++vaos; }
+        void setTransform(unsigned int, glm::mat4 const &) { ++transforms; }
+        void drawElements(unsigned int indexCount) { ++draws; indices += indexCount; }
+        void finish() {}
+    };
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char ** argv) {
+    unsigned int threads = argc > 1 ? std::atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    unsigned int perThread = argc > 2 ? std::atoi(argv[2]) : 25000;
+    unsigned int frames = argc > 3 ? std::atoi(argv[3]) : 20;
+    if (!threads || !perThread || !frames) {
+        std::cout << "usage: " << argv[0] << " [threads] [packets per thread] [frames]" << std::endl;
+        return 1;
+    }
+
+    // a scene-like spread: few programs, more materials, many VAOs, every depth
+    glm::mat4 transform(1.0f);
+    eirikr::RenderQueue queue(threads);
+    double recordTime = 0.0, sortTime = 0.0, replayTime = 0.0;
+    eirikr::RenderQueue::Stats stats = { 0, 0, 0, 0 };
+    bool sorted = true;
+
+    for (unsigned int frame = 0; frame < frames; ++frame) {
+        // only the submit loops are timed, thread startup isn't part of recording;
+        // the threads run side by side, so the slowest one is the frame's record time
+        queue.reset(threads);
+        std::vector<double> loopTimes(threads, 0.0);
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; ++t) {
+            workers.emplace_back([&queue, &transform, &loopTimes, t, perThread, frame]() {
+                auto & recorder = queue.getRecorder(t);
+                unsigned int seed = 2654435761u * (t + 1) + frame;
+                auto start = std::chrono::steady_clock::now();
+                for (unsigned int i = 0; i < perThread; ++i) {
+                    seed = seed * 1664525u + 1013904223u;
+                    recorder.submit(1 + (seed >> 28) % 4, 1 + (seed >> 16) % 256, 1 + (seed >> 8) % 4096, 36,
+                                    (seed & 0xff) / 255.0f, nullptr, &transform);
+                }
+                loopTimes[t] = millisecondsSince(start);
+            });
+        }
+        for (auto & worker : workers) {
+            worker.join();
+        }
+        recordTime += *std::max_element(loopTimes.begin(), loopTimes.end());
+
+        auto start = std::chrono::steady_clock::now();
+        queue.sort();
+        sortTime += millisecondsSince(start);
+
+        auto & packets = queue.getPackets();
+        for (std::size_t i = 1; i < packets.size(); ++i) {
+            if (packets[i - 1].key > packets[i].key) sorted = false;
+        }
+
+        CountingBackend backend;
+        start = std::chrono::steady_clock::now();
+        stats = queue.replay(backend);
+        replayTime += millisecondsSince(start);
+    }
+
+    double packets = static_cast<double>(threads) * perThread;
+    std::cout << threads << " threads, " << static_cast<unsigned long long>(packets) << " packets/frame, "
+              << frames << " frames" << std::endl;
+    std::cout << "record: " << recordTime / frames << " ms/frame, " << packets * frames / recordTime / 1000.0 << " Mpackets/s" << std::endl;
+    std::cout << "sort:   " << sortTime / frames << " ms/frame, " << packets * frames / sortTime / 1000.0 << " Mpackets/s" << std::endl;
+    std::cout << "replay: " << replayTime / frames << " ms/frame, " << packets * frames / replayTime / 1000.0 << " Mpackets/s" << std::endl;
+    std::cout << "last frame: " << stats.draws << " draws, " << stats.programChanges << " program, "
+              << stats.materialChanges << " material, " << stats.vaoChanges << " vao changes" << std::endl;
+    if (!sorted || stats.draws != packets) {
+        std::cout << "Error: packets came out of sort() unordered or incomplete" << std::endl;
+        return 1;
+    }
+    return 0;
+}